@@ -0,0 +1,701 @@
+// Gulnur Yasemin UYGUN 231ADB101
+// Benchmark suite for calc.c
+// Compile with: gcc -O2 -Wall -Wextra -std=c17 -o calc_bench bench.c -lm -pthread
+//
+// -----------------------------------------------------------------------------
+// WHAT THIS PROGRAM DOES (brief):
+// - Includes calc.c (with CALC_NO_MAIN) so it can time the real internals.
+// - calc_bench gen DIR [SCALE]   writes a deterministic synthetic corpus:
+//     deep_nesting/   ((((...)))) and ----...1 chains
+//     long_sums/      1 + 2 + 3 + ... with thousands of terms
+//     float_heavy/    sums/products of float literals with exponents
+//     comment_heavy/  few expressions buried in '#' lines and padding
+//     many_small/     thousands of tiny one-expression files
+//     huge/           one multi-line file (use with -l)
+//   The same SCALE always produces byte-identical files.
+// - calc_bench run DIR           runs every benchmark over a corpus.
+// - calc_bench [SCALE]           generates into a temp dir and runs.
+// - Output: one JSON object per line on stdout, keys in a fixed order, e.g.
+//     {"bench":"next_token","case":"long_sums","ns_per_token":3.1,"mb_per_s":412.0}
+//   so two builds can be compared with diff or jq. next_token_ref and
+//   scan_number_ref time the previous byte-at-a-time scanner and the old
+//   strtod/strtoll number reader on the same inputs for comparison.
+// - Before timing, next_token is checked token for token against that
+//   scanner, and scan_number bit for bit against the old strtod/strtoll one
+//   (on every case and on 5M random literals), and result formatting
+//   against the old integral check + %.15g (and --shortest for round trips)
+//   on 2M random doubles; a mismatch exits with 1.
+// -----------------------------------------------------------------------------
+
+#define CALC_NO_MAIN
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"   // CLI-only helpers
+#include "calc.c"
+#pragma GCC diagnostic pop
+
+#include <stdarg.h>     // For variadic report()/text_addf()
+#include <time.h>       // For clock_gettime()
+
+#define MIN_BENCH_NS 200000000.0   // Repeat each benchmark for at least 0.2 s
+#define NUMBER_CHECKS 5000000      // Random literals checked against the old number scanner
+#define FORMAT_CHECKS 2000000      // Random doubles checked against %.15g and for round trips
+
+// ============================ Deterministic RNG =============================
+
+static unsigned long long rng_state;
+
+// xorshift64: same seed, same corpus on every machine
+static unsigned long long rng_next(void){
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static unsigned rng_below(unsigned n){ return (unsigned)(rng_next() % n); }
+
+// ============================ Corpus generator ==============================
+
+// Growable text buffer used to build one file at a time
+typedef struct { char *p; size_t len, cap; } Text;
+
+static void text_reserve(Text *t, size_t extra){
+    if(t->len + extra + 1 <= t->cap) return;
+    size_t nc = t->cap ? t->cap : 4096;
+    while(nc < t->len + extra + 1) nc *= 2;
+    char *np = (char*)realloc(t->p, nc);
+    if(!np){ fprintf(stderr,"out of memory\n"); exit(1); }
+    t->p = np; t->cap = nc;
+}
+
+static void text_add(Text *t, const char *s){
+    size_t n = strlen(s);
+    text_reserve(t, n);
+    memcpy(t->p + t->len, s, n); t->len += n;
+}
+
+static void text_addf(Text *t, const char *fmt, ...) __attribute__((format(printf,2,3)));
+static void text_addf(Text *t, const char *fmt, ...){
+    char tmp[128];
+    va_list ap; va_start(ap, fmt);
+    int n = vsnprintf(tmp, sizeof tmp, fmt, ap);
+    va_end(ap);
+    if(n > 0) text_add(t, tmp);
+}
+
+// Exits unless a path was built (arena_printf() returns NULL when out of memory)
+static char *need_path(char *path){
+    if(!path){ fprintf(stderr,"out of memory\n"); exit(1); }
+    return path;
+}
+
+// Writes t to DIR/SUB/NAME (creating SUB) and empties t
+static void text_flush_to(Text *t, const char *dir, const char *sub, const char *name){
+    Arena A = {0};
+    char *path = need_path(arena_printf(&A, "%s/%s", dir, sub));
+    if(ensure_dir(path)!=0){ fprintf(stderr,"cannot create %s\n", path); exit(1); }
+    path = need_path(arena_printf(&A, "%s/%s/%s", dir, sub, name));
+    FILE *f = fopen(path, "wb");
+    if(!f || fwrite(t->p, 1, t->len, f) != t->len){ fprintf(stderr,"write fail: %s\n", path); exit(1); }
+    fclose(f);
+    arena_free(&A);
+    t->len = 0;
+}
+
+// A random float literal such as 12.375 or 4.5e-3
+static void add_float(Text *t){
+    if(rng_below(4)==0) text_addf(t, "%u.%ue%s%u", rng_below(10), rng_below(1000), rng_below(2)?"-":"", rng_below(20));
+    else text_addf(t, "%u.%03u", rng_below(1000), rng_below(1000));
+}
+
+// Generates the whole corpus; scale multiplies sizes and counts
+static void gen_corpus(const char *dir, unsigned scale){
+    Text t = {0};
+    char name[64];
+    rng_state = 0x9E3779B97F4A7C15ull;
+    if(ensure_dir(dir)!=0){ fprintf(stderr,"cannot create %s\n", dir); exit(1); }
+
+    // Deep nesting: parentheses and unary minus chains
+    for(unsigned f=0; f<4; f++){
+        unsigned depth = 500u * scale * (f+1);
+        for(unsigned k=0;k<depth;k++) text_add(&t, "(");
+        text_addf(&t, "%u", rng_below(100));
+        for(unsigned k=0;k<depth;k++) text_addf(&t, " %s %u)", rng_below(2)?"+":"*", 1+rng_below(9));
+        text_add(&t, "\n");
+        snprintf(name, sizeof name, "paren%u.txt", f);
+        text_flush_to(&t, dir, "deep_nesting", name);
+
+        for(unsigned k=0;k<depth;k++) text_add(&t, "-");
+        text_add(&t, "1\n");
+        snprintf(name, sizeof name, "unary%u.txt", f);
+        text_flush_to(&t, dir, "deep_nesting", name);
+    }
+
+    // Long sums of small integers
+    for(unsigned f=0; f<8; f++){
+        unsigned terms = 20000u * scale;
+        text_addf(&t, "%u", rng_below(1000));
+        for(unsigned k=1;k<terms;k++) text_addf(&t, " %c %u", rng_below(3)?'+':'-', rng_below(1000));
+        text_add(&t, "\n");
+        snprintf(name, sizeof name, "sum%u.txt", f);
+        text_flush_to(&t, dir, "long_sums", name);
+    }
+
+    // Float-heavy: float literals with every operator
+    static const char *ops[] = { "+", "-", "*", "/" };
+    for(unsigned f=0; f<8; f++){
+        unsigned terms = 10000u * scale;
+        add_float(&t);
+        for(unsigned k=1;k<terms;k++){ text_addf(&t, " %s ", ops[rng_below(4)]); add_float(&t); }
+        text_add(&t, "\n");
+        snprintf(name, sizeof name, "float%u.txt", f);
+        text_flush_to(&t, dir, "float_heavy", name);
+    }
+
+    // Comment-heavy: one expression per ~20 comment lines, padded with spaces
+    for(unsigned f=0; f<8; f++){
+        unsigned lines = 5000u * scale;
+        for(unsigned k=0;k<lines;k++){
+            if(k%20==10) text_addf(&t, "   (%u + %u) * %u   \n", rng_below(100), rng_below(100), rng_below(10));
+            else text_addf(&t, "%*s# comment line %u with some filler text\n", (int)rng_below(12), "", k);
+        }
+        snprintf(name, sizeof name, "comments%u.txt", f);
+        text_flush_to(&t, dir, "comment_heavy", name);
+    }
+
+    // Many small files (the typical task-file shape)
+    for(unsigned f=0; f<2000u*scale; f++){
+        text_addf(&t, "%u %s %u %s (%u.5 - %u)\n", rng_below(100), ops[rng_below(4)], rng_below(100),
+                  ops[rng_below(3)], rng_below(10), rng_below(10));
+        snprintf(name, sizeof name, "task%05u.txt", f);
+        text_flush_to(&t, dir, "many_small", name);
+    }
+
+    // One huge multi-line file
+    for(unsigned k=0;k<200000u*scale;k++){
+        if(k%50==0) text_add(&t, "# section\n");
+        text_addf(&t, "%u + %u * (%u - ", rng_below(1000), rng_below(100), rng_below(100));
+        add_float(&t);
+        text_add(&t, ")\n");
+    }
+    text_flush_to(&t, dir, "huge", "huge.txt");
+
+    free(t.p);
+}
+
+// =============================== Reporting ==================================
+
+static double now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// One JSON line: bench, case, then metric/value pairs (NULL-terminated)
+static void report(const char *bench, const char *kase, ...){
+    printf("{\"bench\":\"%s\",\"case\":\"%s\"", bench, kase);
+    va_list ap; va_start(ap, kase);
+    const char *key;
+    while((key = va_arg(ap, const char*)) != NULL)
+        printf(",\"%s\":%.3f", key, va_arg(ap, double));
+    va_end(ap);
+    printf("}\n");
+    fflush(stdout);
+}
+
+// ============================ Reference scanner =============================
+// The scanner as it was before the character-class table: byte-at-a-time
+// whitespace/comment skipping and an if-chain over <ctype.h>. Kept here so
+// next_token can be timed against it, and checked token for token.
+
+static void ref_skip_ws_and_comments(Scanner *S){
+    for(;;){
+        while(S->idx0 < S->len && (
+            S->src[S->idx0]==' '  ||
+            S->src[S->idx0]=='\t' ||
+            S->src[S->idx0]=='\r' ||
+            S->src[S->idx0]=='\n'
+        )){ S->idx0++; S->pos++; }
+        if(S->idx0 < S->len && S->src[S->idx0]=='#'){
+            while(S->idx0 < S->len && S->src[S->idx0] != '\n'){
+                S->idx0++; S->pos++;
+            }
+            continue;
+        }
+        break;
+    }
+}
+
+static Token ref_next_token(Scanner *S){
+    ref_skip_ws_and_comments(S);
+    if(S->idx0 >= S->len) return make_simple(T_EOF, S->pos);
+
+    char c = S->src[S->idx0];
+    size_t p = S->pos;
+
+    if(isdigit((unsigned char)c) || c=='.') return scan_number(S);
+    if(isalpha((unsigned char)c) || c=='_'){
+        Token t = make_simple(T_IDENT, p);
+        size_t s0 = S->idx0;
+        while(S->idx0 < S->len && (isalnum((unsigned char)S->src[S->idx0]) || S->src[S->idx0]=='_')){
+            S->idx0++; S->pos++;
+        }
+        t.name = S->src + s0; t.name_len = S->idx0 - s0;
+        return t;
+    }
+    if(c=='+'){ S->idx0++; S->pos++; return make_simple(T_PLUS, p); }
+    if(c=='-'){ S->idx0++; S->pos++; return make_simple(T_MINUS, p); }
+    if(c=='('){ S->idx0++; S->pos++; return make_simple(T_LPAREN, p); }
+    if(c==')'){ S->idx0++; S->pos++; return make_simple(T_RPAREN, p); }
+    if(c=='/'){ S->idx0++; S->pos++; return make_simple(T_SLASH, p); }
+    if(c=='*'){
+        if(S->idx0+1 < S->len && S->src[S->idx0+1]=='*'){
+            S->idx0+=2; S->pos+=2;
+            return make_simple(T_POW, p);
+        }
+        S->idx0++; S->pos++;
+        return make_simple(T_STAR, p);
+    }
+    S->idx0++; S->pos++;
+    return make_simple(T_INVALID, p);
+}
+
+// Exits unless next_token and ref_next_token agree on every token
+static void check_scanner(const char *kase, const char *buf, size_t len){
+    Scanner A, B; memset(&A,0,sizeof A); memset(&B,0,sizeof B);
+    A.src=B.src=buf; A.len=B.len=len; A.pos=B.pos=1;
+    for(;;){
+        Token x = next_token(&A), y = ref_next_token(&B);
+        if(x.type!=y.type || x.start_pos!=y.start_pos || A.idx0!=B.idx0 || A.pos!=B.pos){
+            fprintf(stderr,"scanner mismatch in %s at pos %zu\n", kase, y.start_pos);
+            exit(1);
+        }
+        if(x.type==T_EOF || x.type==T_INVALID) return;   // A lone '.' does not advance
+    }
+}
+
+// The number scanner as it was before the one-pass scanner: strtod for the
+// extent and the double, strtoll for integers (ERANGE = too big for long
+// long, which made the literal a double; scan_number now keeps it as a wide
+// integer with the same double).
+static Token ref_scan_number(Scanner *S){
+    size_t start = S->pos, n = 0, rest = S->len - S->idx0;
+    const char *p = S->src + S->idx0;
+    while(n < rest && (isxdigit((unsigned char)p[n]) || strchr("xXpP.+-", p[n]))) n++;
+    size_t used;
+    double dv = strtod_bounded(p, n, &used);      // strtod stops inside the window
+    if(used == 0) return make_simple(T_INVALID, start);
+    S->idx0 += used; S->pos += used;
+
+    Token t; memset(&t,0,sizeof t);
+    t.type = T_NUM; t.start_pos = start;
+    int saw_dot_or_exp = 0;
+    for(size_t i=0;i<used;i++)
+        if(p[i]=='.' || p[i]=='e' || p[i]=='E'){ saw_dot_or_exp = 1; break; }
+    if(saw_dot_or_exp){ t.is_float=1; t.d=dv; return t; }
+    char digits[64];
+    size_t dn = used < sizeof digits - 1 ? used : sizeof digits - 1;
+    memcpy(digits, p, dn); digits[dn] = '\0';
+    errno = 0;
+    long long iv = strtoll(digits, NULL, 10);
+    if(errno==ERANGE || used != dn){ t.is_float=1; t.d=dv; }   // Overflow => use double
+    else { t.is_float=0; t.i=iv; t.d=dv; }
+    return t;
+}
+
+// Exits unless scan_number and ref_scan_number read every number literal of
+// buf to the same extent and bit-identical values
+static void check_numbers(const char *kase, const char *buf, size_t len){
+    Scanner S; memset(&S,0,sizeof S);
+    S.src=buf; S.len=len; S.pos=1;
+    for(;;){
+        skip_ws_and_comments(&S);
+        if(S.idx0 >= S.len) return;
+        unsigned char c = (unsigned char)buf[S.idx0];
+        if(isdigit(c) || c=='.'){
+            Scanner A = S, B = S;
+            Token x = scan_number(&A), y = ref_scan_number(&B);
+            int xf = x.is_float || x.wide;
+            if(x.type!=y.type || A.idx0!=B.idx0 || xf!=y.is_float ||
+               (!xf && x.i!=y.i) || memcmp(&x.d, &y.d, sizeof x.d)!=0){
+                fprintf(stderr,"number mismatch in %s at pos %zu: %.*s\n", kase, S.pos,
+                        (int)(B.idx0 > S.idx0 ? B.idx0 - S.idx0 : 1), buf + S.idx0);
+                exit(1);
+            }
+        }
+        Token k = next_token(&S);
+        if(k.type==T_EOF || k.type==T_INVALID) return;   // A lone '.' does not advance
+    }
+}
+
+// check_numbers over n random literals: short and long mantissas, leading
+// and trailing zeros, exponents near the subnormal and overflow limits,
+// integers around LLONG_MAX and hex
+static void check_numbers_random(size_t n){
+    Text t = {0};
+    rng_state = 2024;
+    for(size_t k=0;k<n;k++){
+        switch(rng_below(6)){
+        case 0: text_addf(&t, "%llu", rng_next() >> rng_below(64)); break;
+        case 1: text_addf(&t, "%llu%u", (unsigned long long)LLONG_MAX - rng_below(3), rng_below(100)); break;
+        case 2: text_addf(&t, "0x%llx", rng_next() >> rng_below(64)); break;
+        default: {
+            int nd = 1 + (int)rng_below(rng_below(4) ? 20 : 40), dot = (int)rng_below((unsigned)nd + 2);
+            for(int d=0; d<nd; d++){
+                if(d == dot) text_add(&t, ".");
+                text_addf(&t, "%u", d < 2 && rng_below(3)==0 ? 0u : rng_below(10));
+            }
+            if(rng_below(2)) text_addf(&t, "%se%s%d", rng_below(4) ? "" : ".", rng_below(2) ? "-" : "+",
+                                       (int)rng_below(rng_below(4) ? 30 : 340));
+        }
+        }
+        text_add(&t, rng_below(8) ? "\n" : " + ");
+    }
+    check_numbers("random_literals", t.p, t.len);
+    free(t.p);
+}
+
+// ============================ Microbenchmarks ===============================
+
+// Loads DIR/SUB/NAME into memory (exits on failure)
+static char *load(const char *dir, const char *sub, const char *name, size_t *len){
+    Arena A = {0};
+    char *path = need_path(arena_printf(&A, "%s/%s/%s", dir, sub, name)), *buf;
+    if(read_entire_file(path, &buf, len)!=0){ fprintf(stderr,"read fail: %s\n", path); exit(1); }
+    arena_free(&A);
+    return buf;
+}
+
+static size_t count_tokens(const char *buf, size_t len){
+    Scanner S; memset(&S,0,sizeof S);
+    S.src=buf; S.len=len; S.pos=1;
+    size_t n = 0;
+    for(Token k = next_token(&S); k.type != T_EOF && k.type != T_INVALID; k = next_token(&S)) n++;
+    return n;
+}
+
+// next_token (or the reference scanner, as "next_token_ref") over a whole buffer
+static void bench_scanner(const char *bench, Token (*scan)(Scanner*), const char *kase,
+                          const char *buf, size_t len){
+    size_t ntok = count_tokens(buf, len), iters = 0;
+    volatile size_t sink = 0;
+    double t0 = now_ns(), t;
+    do{
+        Scanner S; memset(&S,0,sizeof S);
+        S.src=buf; S.len=len; S.pos=1;
+        for(Token k = scan(&S); k.type != T_EOF && k.type != T_INVALID; k = scan(&S)) sink += k.type;
+        iters++;
+    }while((t = now_ns() - t0) < MIN_BENCH_NS);
+    (void)sink;
+    report(bench, kase, "ns_per_token", t / ((double)iters*ntok),
+           "mb_per_s", (double)iters*len / t * 1e3, (const char*)NULL);
+}
+
+static void bench_next_token(const char *kase, const char *buf, size_t len){
+    check_scanner(kase, buf, len);
+    bench_scanner("next_token", next_token, kase, buf, len);
+    bench_scanner("next_token_ref", ref_next_token, kase, buf, len);
+}
+
+// scan (scan_number, or the old reader as "scan_number_ref") on n number
+// literals starting at at[], bytes long in total
+static void bench_numbers(const char *bench, Token (*scan)(Scanner*), const char *kase,
+                          const char *buf, size_t len, const size_t *at, size_t n, size_t bytes){
+    size_t iters = 0;
+    volatile double sink = 0;
+    double t0 = now_ns(), t;
+    do{
+        for(size_t k=0;k<n;k++){
+            Scanner N; memset(&N,0,sizeof N);
+            N.src=buf; N.len=len; N.idx0=at[k]; N.pos=at[k]+1;
+            Token tk = scan(&N);
+            sink += tk.is_float ? tk.d : (double)tk.i;
+        }
+        iters++;
+    }while((t = now_ns() - t0) < MIN_BENCH_NS);
+    (void)sink;
+    report(bench, kase, "ns_per_number", t / ((double)iters*n),
+           "mb_per_s", (double)iters*bytes / t * 1e3, (const char*)NULL);
+}
+
+// Number reading on every number literal of a buffer (positions found up front)
+static void bench_scan_number(const char *kase, const char *buf, size_t len){
+    check_numbers(kase, buf, len);
+    size_t *at = NULL, n = 0, cap = 0, bytes = 0;
+    Scanner S; memset(&S,0,sizeof S);
+    S.src=buf; S.len=len; S.pos=1;
+    for(;;){
+        skip_ws_and_comments(&S);
+        size_t i0 = S.idx0;
+        Token k = next_token(&S);
+        if(k.type == T_EOF || k.type == T_INVALID) break;
+        if(k.type == T_NUM){
+            if(grow_array((void**)&at, &cap, n+1, sizeof *at)!=0) exit(1);
+            at[n++] = i0; bytes += S.idx0 - i0;
+        }
+    }
+    if(n){
+        bench_numbers("scan_number", scan_number, kase, buf, len, at, n, bytes);
+        bench_numbers("scan_number_ref", ref_scan_number, kase, buf, len, at, n, bytes);
+    }
+    free(at);
+}
+
+// Full parse + evaluate (eval_buffer, or per line for multi-line cases)
+static void bench_parse(const char *kase, const char *buf, size_t len, int lines){
+    size_t ntok = count_tokens(buf, len), iters = 0;
+    volatile size_t sink = 0;
+    double t0 = now_ns(), t;
+    do{
+        if(lines){
+            size_t ls = 0, le;
+            while(next_expr_line(buf, len, &ls, &le)){
+                sink += eval_buffer_at(buf+ls, le-ls, ls+1).ok;
+                ls = le + 1;
+            }
+        } else sink += eval_buffer(buf, len).ok;
+        iters++;
+    }while((t = now_ns() - t0) < MIN_BENCH_NS);
+    (void)sink;
+    report("parse_eval", kase, "ns_per_token", t / ((double)iters*ntok),
+           "mb_per_s", (double)iters*len / t * 1e3, (const char*)NULL);
+}
+
+// The same through a Source window over the file (how "-" and inputs of
+// IO_STREAM_MIN bytes or more are evaluated); -l results go to /dev/null
+static void bench_parse_stream(const char *kase, const char *dir, const char *name, const char *buf,
+                               size_t len, int lines){
+    Arena A = {0};
+    char *path = need_path(arena_printf(&A, "%s/%s/%s", dir, kase, name));
+    int fd = open(path, O_RDONLY), null = open("/dev/null", O_WRONLY);
+    char *win = (char*)malloc(STREAM_WINDOW + OUTBUF_SIZE);
+    if(fd<0 || null<0 || !win){ fprintf(stderr,"read fail: %s\n", path); exit(1); }
+    arena_free(&A);
+    size_t ntok = count_tokens(buf, len), iters = 0;
+    volatile size_t sink = 0;
+    double t0 = now_ns(), t;
+    do{
+        lseek(fd, 0, SEEK_SET);
+        Source src; source_init(&src, fd, win, STREAM_WINDOW, lines);
+        if(lines){
+            OutBuf ob; ob_open(&ob, null, win + STREAM_WINDOW, OUTBUF_SIZE, 0);
+            eval_lines_stream(&src, &ob);
+            ob_flush(&ob);
+            sink += ob.written;
+        } else sink += eval_stream(&src).ok;
+        iters++;
+    }while((t = now_ns() - t0) < MIN_BENCH_NS);
+    (void)sink;
+    report("parse_eval_stream", kase, "ns_per_token", t / ((double)iters*ntok),
+           "mb_per_s", (double)iters*len / t * 1e3, (const char*)NULL);
+    free(win); close(fd); close(null);
+}
+
+// -l over one buffer split across one thread per CPU (a single input with
+// -l -j 0); results go to /dev/null
+static void bench_lines_split(const char *kase, const char *buf, size_t len){
+    int null = open("/dev/null", O_WRONLY);
+    char *storage = (char*)malloc(OUTBUF_SIZE);
+    if(null<0 || !storage){ fprintf(stderr,"out of memory\n"); exit(1); }
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t ntok = count_tokens(buf, len), iters = 0;
+    double t0 = now_ns(), t;
+    do{
+        OutBuf ob; ob_open(&ob, null, storage, OUTBUF_SIZE, 0);
+        if(eval_lines_split(buf, len, &ob, jobs > 0 ? (int)jobs : 1)!=0) exit(1);
+        iters++;
+    }while((t = now_ns() - t0) < MIN_BENCH_NS);
+    report("parse_eval_split", kase, "ns_per_token", t / ((double)iters*ntok),
+           "mb_per_s", (double)iters*len / t * 1e3, (const char*)NULL);
+    free(storage); close(null);
+}
+
+// A double as the old print_value wrote it: the integral check, then %.15g
+static size_t ref_format_double(char *dst, double x){
+    if(is_integral_double(x)) return (size_t)snprintf(dst, RESULT_MAX, "%lld", (long long)llround(x));
+    return (size_t)snprintf(dst, RESULT_MAX, "%.15g", x);
+}
+
+// A random double: random bits, short decimals, near-integers, values whose
+// 16th and 17th digits sit near a %.15g rounding midpoint, and extremes
+static double random_double(void){
+    unsigned long long bits = rng_next();
+    double x;
+    switch(rng_below(6)){
+    case 0: memcpy(&x, &bits, sizeof x); if(!isfinite(x)) x = 1.5; break;
+    case 1: x = (double)(bits % 2000000) / 8.0 - 125000.0; break;
+    case 2: x = (double)(bits % 1000000000) / 7.0; break;
+    case 3: x = (double)(long long)(bits % 20000000001ull - 10000000000ll) + (double)rng_below(3) * 1e-13; break;
+    case 4: x = ((double)(bits % 1000000000000000ull) + 0.5 + (double)rng_below(3) * 1e-3) *
+                pow(10.0, (double)rng_below(40) - 30.0); break;
+    default: x = ldexp(1.0 + (double)(bits >> 12) / 4503599627370496.0, (int)rng_below(2100) - 1074); break;
+    }
+    return rng_below(2) ? -x : x;
+}
+
+// Exits unless fmt_double matches the old print_value layout byte for byte,
+// and --shortest output reads back as the same double, on n random values
+static void check_format(size_t n){
+    char a[RESULT_MAX+1], b[RESULT_MAX+1];
+    rng_state = 777;
+    for(size_t k=0;k<n;k++){
+        double x = random_double();
+        size_t la = fmt_double(a, x, 0), lb = ref_format_double(b, x);
+        a[la] = '\0';
+        if(la!=lb || memcmp(a, b, la)!=0){
+            fprintf(stderr,"format mismatch for %a: %s, %%.15g: %s\n", x, a, b);
+            exit(1);
+        }
+        la = fmt_double(a, x, 1); a[la] = '\0';
+        if(strtod(a, NULL) != x){
+            fprintf(stderr,"shortest format does not read back for %a: %s\n", x, a);
+            exit(1);
+        }
+    }
+}
+
+// Result formatting (the old print_value, now format_result)
+static void bench_format(void){
+    check_format(FORMAT_CHECKS);
+    enum { N = 4096 };
+    static EvalResult rs[3][N];
+    rng_state = 12345;
+    for(int k=0;k<N;k++){
+        rs[0][k] = (EvalResult){ 1, make_int((long long)(rng_next() % 2000000000ull) - 1000000000), 0 };
+        rs[1][k] = (EvalResult){ 1, make_double((double)(rng_next() % 1000000) / 7.0), 0 };
+        rs[2][k] = (EvalResult){ 1, make_double((double)(rng_next() % 1000) / 8.0), 0 };
+    }
+    static const char *names[3] = { "int", "double_17digit", "double_short" };
+    char out[RESULT_MAX];
+    for(int c=0;c<3;c++) for(int shortest=0; shortest<2; shortest++){
+        size_t iters = 0, bytes = 0;
+        double t0 = now_ns(), t;
+        do{
+            for(int k=0;k<N;k++) bytes += format_result(out, &rs[c][k], shortest);
+            iters++;
+        }while((t = now_ns() - t0) < MIN_BENCH_NS);
+        char kase[64];
+        snprintf(kase, sizeof kase, "%s%s", names[c], shortest ? "_shortest" : "");
+        report("format_result", kase, "ns_per_value", t / ((double)iters*N),
+               "mb_per_s", (double)bytes / t * 1e3, (const char*)NULL);
+    }
+}
+
+// =========================== End-to-end: process_dir ========================
+
+// Counts *.txt files and their total size in a directory
+static void dir_stats(const char *path, size_t *files, size_t *bytes){
+    *files = 0; *bytes = 0;
+    DIR *d = opendir(path);
+    if(!d) return;
+    struct dirent *ent;
+    while((ent = readdir(d)) != NULL){
+        if(!ends_with_txt(ent->d_name)) continue;
+        struct stat st;
+        if(fstatat(dirfd(d), ent->d_name, &st, 0)==0){ (*files)++; *bytes += (size_t)st.st_size; }
+    }
+    closedir(d);
+}
+
+// Times process_dir over in (outputs in out); fl is a writable copy of flags
+static void bench_process_run(char *in, char *out, const char *sub, const char *flags, char *fl){
+    // Build Options through the real parser so flags mean what they mean in calc
+    char *argv[16] = { "calc", "-d", in, "-o", out };
+    int argc = 5;
+    for(char *tok = strtok(fl, " "); tok && argc < 15; tok = strtok(NULL, " ")) argv[argc++] = tok;
+    Options opt;
+    if(parse_args(argc, argv, &opt)!=0) return;
+
+    size_t files, bytes, iters = 0;
+    dir_stats(in, &files, &bytes);
+    double t0 = now_ns(), t;
+    do{
+        Pack pack;                              // --pack: one packed run per iteration, as in calc
+        if(opt.pack){
+            if(pack_open(&pack, out)!=0){ fprintf(stderr,"pack open failed: %s\n", out); return; }
+            opt.packed = &pack;
+        }
+        int rc = process_dir(in, out, &opt);
+        if(opt.pack){
+            if(pack_commit(&pack)!=0) rc = -1;
+            pack_close(&pack);
+        }
+        if(rc!=0){ fprintf(stderr,"process_dir failed: %s\n", in); return; }
+        iters++;
+    }while((t = now_ns() - t0) < MIN_BENCH_NS);
+
+    char kase[128];
+    snprintf(kase, sizeof kase, "%s%s%s", sub, *flags ? " " : "", flags);
+    report("process_dir", kase, "files_per_s", (double)iters*files / t * 1e9,
+           "mb_per_s", (double)iters*bytes / t * 1e3, (const char*)NULL);
+}
+
+// Times process_dir over DIR/SUB with the given extra CLI flags
+static void bench_process_dir(const char *dir, const char *sub, const char *flags){
+    Arena A = {0};
+    char *in = need_path(arena_printf(&A, "%s/%s", dir, sub));
+    char *out = need_path(arena_printf(&A, "%s/_out_%s", dir, sub));
+    if(ensure_dir(out)==0) bench_process_run(in, out, sub, flags, need_path(arena_printf(&A, "%s", flags)));
+    arena_free(&A);
+}
+
+// ================================== main ====================================
+
+static void run_all(const char *dir){
+    check_numbers_random(NUMBER_CHECKS);
+    static const struct { const char *sub, *file; int lines; } cases[] = {
+        { "deep_nesting",  "paren0.txt",    0 },
+        { "long_sums",     "sum0.txt",      0 },
+        { "float_heavy",   "float0.txt",    0 },
+        { "comment_heavy", "comments0.txt", 1 },
+        { "huge",          "huge.txt",      1 },
+    };
+    for(size_t c=0;c<sizeof cases/sizeof cases[0];c++){
+        size_t len;
+        char *buf = load(dir, cases[c].sub, cases[c].file, &len);
+        bench_next_token(cases[c].sub, buf, len);
+        bench_scan_number(cases[c].sub, buf, len);
+        bench_parse(cases[c].sub, buf, len, cases[c].lines);
+        bench_parse_stream(cases[c].sub, dir, cases[c].file, buf, len, cases[c].lines);
+        if(cases[c].lines) bench_lines_split(cases[c].sub, buf, len);
+        free(buf);
+    }
+    bench_format();
+
+    bench_process_dir(dir, "many_small", "");
+    bench_process_dir(dir, "many_small", "-j 0");
+    bench_process_dir(dir, "many_small", "--pack");
+    bench_process_dir(dir, "long_sums", "");
+    bench_process_dir(dir, "comment_heavy", "-l");
+    bench_process_dir(dir, "huge", "-l");
+}
+
+static void bench_usage(const char *prog){
+    fprintf(stderr,
+      "Usage: %s gen DIR [SCALE]   write the synthetic corpus\n"
+      "       %s run DIR           benchmark an existing corpus\n"
+      "       %s [SCALE]           generate into a temp dir and benchmark\n",
+      prog, prog, prog);
+}
+
+int main(int argc, char **argv){
+    if(argc >= 3 && strcmp(argv[1],"gen")==0){
+        gen_corpus(argv[2], argc > 3 ? (unsigned)atoi(argv[3]) : 1);
+        return 0;
+    }
+    if(argc == 3 && strcmp(argv[1],"run")==0){
+        run_all(argv[2]);
+        return 0;
+    }
+    if(argc > 2 || (argc == 2 && atoi(argv[1]) <= 0)){
+        bench_usage(argv[0]);
+        return 1;
+    }
+
+    char dir[] = "/tmp/calc_bench_XXXXXX";
+    if(!mkdtemp(dir)){ perror("mkdtemp"); return 1; }
+    gen_corpus(dir, argc == 2 ? (unsigned)atoi(argv[1]) : 1);
+    fprintf(stderr, "corpus: %s\n", dir);
+    run_all(dir);
+    return 0;
+}
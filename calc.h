@@ -0,0 +1,68 @@
+// Gulnur Yasemin UYGUN 231ADB101
+// libcalc: the expression evaluator of calc.c as an in-process library.
+//
+// Static:  gcc -O2 -Wall -Wextra -std=c17 -fPIC -DCALC_LIB -c -o libcalc.o calc.c
+//          ar rcs libcalc.a libcalc.o
+// Shared:  gcc -O2 -Wall -Wextra -std=c17 -fPIC -DCALC_LIB -shared -o libcalc.so calc.c -lm -pthread
+// Link:    gcc ... app.c -L. -lcalc -lm -pthread
+//
+// A calc_ctx holds everything an evaluation needs (nesting limit, allocator,
+// bignum scratch). Calls find it through a thread-local pointer that is set
+// on entry and restored on return, so there is no state shared between
+// threads: contexts are independent and each may be used by one thread at a
+// time. calc_eval_text() returns exactly the line the calc CLI would write
+// for the same input; calc_result holds integers only up to long long.
+#ifndef CALC_H
+#define CALC_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Allocator with realloc() semantics: ptr NULL allocates, size 0 frees
+// (and returns NULL). ud is calc_options.alloc_ud.
+typedef void *(*calc_alloc_fn)(void *ud, void *ptr, size_t size);
+
+typedef struct {
+    size_t max_depth;           // Pending operators/parentheses before ERROR (0 = CLI default)
+    int shortest;               // calc_eval_text: shortest round-trip doubles
+    calc_alloc_fn alloc;        // NULL = malloc/realloc/free
+    void *alloc_ud;
+} calc_options;
+
+typedef struct calc_ctx calc_ctx;
+
+typedef struct {
+    int ok;                     // 1 = value below, 0 = ERROR at err_pos
+    size_t err_pos;             // 1-based byte position of the error
+    int is_float;               // The value is a double (from '/' or a float operand)
+    int exact;                  // Integer that fits in i; otherwise d approximates it
+                                // (calc_eval_text has the exact digits)
+    long long i;
+    double d;
+} calc_result;
+
+typedef struct { const char *ptr; size_t len; } calc_expr;
+
+// Creates a context (opt NULL = defaults); NULL if out of memory
+calc_ctx *calc_new(const calc_options *opt);
+void calc_free(calc_ctx *c);
+
+// Evaluates expr[0..len) as one expression; returns out->ok
+int calc_eval(calc_ctx *c, const char *expr, size_t len, calc_result *out);
+
+// Evaluates in[0..n) into out[0..n); returns how many succeeded
+size_t calc_eval_batch(calc_ctx *c, const calc_expr *in, size_t n, calc_result *out);
+
+// Evaluates expr and formats the CLI's output line ("42\n", "ERROR:3\n").
+// Returns the line's length; the line is stored only if it fits in cap
+// bytes (integers may have thousands of digits).
+size_t calc_eval_text(calc_ctx *c, const char *expr, size_t len, char *buf, size_t cap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif